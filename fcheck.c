@@ -3,6 +3,9 @@
 // Description: Checking the consistency of the given file system image
 
 
+// Use 64-bit off_t so that images larger than 2 GB can be opened and mapped
+#define _FILE_OFFSET_BITS 64
+
 // Include Files
 #include "types.h"
 #include "fs.h"
@@ -16,8 +19,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
-#include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // Some global variables which will be used across the functions of this file
 // Most of these below variables are calculated in the main function and then functions use them for various checks
@@ -26,14 +29,23 @@ char* sbAddr; 				// address of the super block
 char* inodeBlockStartAddr; 	// Address of the first inode block
 char* dataBitmapStartAddr; 	// Address of the first Data Bitmap block
 char* dataBlockStartAddr;	// Address of the first Data Block
-uint noOfInodeBlocks; 		// Total number of inode blocks present
-uint noOfDataBitmapBlocks;	// Total number of Data Bitmap blocks present
-uint noOfDataBlocks;		// Total number of Data Blocks present
+uint64 noOfBlocks;			// Total number of blocks present in the fs img
+uint64 noOfInodeBlocks; 	// Total number of inode blocks present
+uint64 noOfDataBitmapBlocks;	// Total number of Data Bitmap blocks present
+uint64 noOfDataBlocks;		// Total number of Data Blocks present
 
 struct superblock* sb;		// struct to store the superblock info of the fs img given
 
 #define BLOCK_SIZE (BSIZE)	// Size of the block
 
+// Address of block b in the fs img, computed in 64 bits so large images don't overflow
+#define BLOCK_ADDR(b) (addr + (uint64)(b) * BLOCK_SIZE)
+
+// One bit per data block for the custom bitmaps built by the checks, same bit order as the on-disk bitmap
+#define BITMAP_BYTES(n) (((n) + 7) / 8)
+#define BIT_GET(map, b) (((map)[(b) / 8] >> ((b) % 8)) & 1)
+#define BIT_SET(map, b) ((map)[(b) / 8] |= (uchar)(1 << ((b) % 8)))
+
 
 // Check 1
 // Each inode is either unallocated or one of the valid types (T_FILE, T_DIR, T_DEV). If not, print ERROR: bad inode.
@@ -60,21 +72,25 @@ void check1(){
 // For in-use inodes, each block address that is used by the inode is valid (points to a valid data block address within the image). If the direct block is used and is
 // invalid, print ERROR: bad direct address in inode.; if the indirect block is in use and is invalid, print ERROR: bad indirect address in inode.
 void check2(){
-	int i, j;
+	uint i, j;
 	uint blockNumber;
 
+	// valid data block addresses start after the boot, super, inode and bitmap blocks
+	uint64 firstDataBlock = 1 + 1 + noOfInodeBlocks + noOfDataBitmapBlocks;
+
 	// storing the first inode information in di
 	struct dinode* di = (struct dinode *) inodeBlockStartAddr;
 
 	// looping through each inode to check its direct and indirect addresses
-	for(i = 0; i < noOfInodeBlocks; i++, di++){
+	// every inode is covered, as the later checks index their data block arrays with these addresses
+	for(i = 0; i < sb->ninodes; i++, di++){
 
 		// looping through all direct blocks of the selected inode
 		for(j = 0; j < NDIRECT; j++){
 			blockNumber = di->addrs[j];
 
-			// block number should be in the range of the total number of blocks present in the given fs img
-			if(blockNumber >= 0 && blockNumber < sb->size){
+			// block number should be unused (0) or in the range of the data blocks present in the given fs img
+			if(blockNumber == 0 || (blockNumber >= firstDataBlock && blockNumber < noOfBlocks)){
 				continue;
 			} else{
 				fprintf(stderr, "ERROR: bad direct address in inode.\n");
@@ -85,17 +101,17 @@ void check2(){
 		// Getting the address of block with indirect addresses present
 		uint indirectBlockNo = di->addrs[NDIRECT];
 		if(indirectBlockNo == 0) continue;
-		if(indirectBlockNo < 0 || indirectBlockNo >= sb->size){
+		if(indirectBlockNo < firstDataBlock || indirectBlockNo >= noOfBlocks){
 			fprintf(stderr, "ERROR: bad indirect address in inode.\n");
 			exit(1);
 		}
 
 		// Storing the first indirect entry information in indirectEntry
-		uint* indirectEntry = (uint* ) (addr + indirectBlockNo*BLOCK_SIZE);
+		uint* indirectEntry = (uint* ) BLOCK_ADDR(indirectBlockNo);
 
 		// looping through each indirect entry and validating similar to above
 		for(j = 0; j < NINDIRECT; j++, indirectEntry++){
-			if(*indirectEntry >= 0 && *indirectEntry < sb->size){
+			if(*indirectEntry == 0 || (*indirectEntry >= firstDataBlock && *indirectEntry < noOfBlocks)){
 				continue;
 			} else{
 				fprintf(stderr, "ERROR: bad indirect address in inode.\n");
@@ -138,7 +154,7 @@ void check3(){
 		if(rootInodeBlockNumber == 0) break;
 
 		// getting the first dir entry at the location pointed by the direct address
-		struct dirent* de = (struct dirent*) (addr + rootInodeBlockNumber*BLOCK_SIZE);
+		struct dirent* de = (struct dirent*) BLOCK_ADDR(rootInodeBlockNumber);
 
 		int i;
 
@@ -189,7 +205,7 @@ void check4(){
 		for(j = 0; j < NDIRECT; j++){
 			uint inodeBlockNumber = inode->addrs[j];
 			if(inodeBlockNumber == 0) break;
-			de = (struct dirent*) (addr + inodeBlockNumber*BLOCK_SIZE);
+			de = (struct dirent*) BLOCK_ADDR(inodeBlockNumber);
 
 			// looping through each block of dir entries to check for exitence of dot and dotdot
 			for(k = 0; k < maxDir; k++, de++){
@@ -252,7 +268,7 @@ void check5(){
 
 		// Same for indirect address pointers also to check for bitmap consistency
 		if(inode->addrs[NDIRECT] == 0) continue;
-		uint* indirectEntry = (uint* ) (addr + (inode->addrs[NDIRECT])*BLOCK_SIZE);
+		uint* indirectEntry = (uint* ) BLOCK_ADDR(inode->addrs[NDIRECT]);
 
 		// looping through each indirect entry for consistency check with bitmap
 		for(j = 0; j < NINDIRECT; j++, indirectEntry++){
@@ -276,12 +292,16 @@ void check5(){
 void check6(){
 
 	// Creating a custom bitmap on our own for this consistency check
-    int custom_bitmap[sb->nblocks];
-    memset(custom_bitmap, 0, sb->nblocks*sizeof(int)); // initializing with zero values for the custom bitmap
-    int temp, firstDataBlock = 1 + 1 + noOfInodeBlocks + noOfDataBitmapBlocks;
+	// allocated on the heap, as large images have far too many data blocks for the stack
+    uchar* custom_bitmap = calloc(BITMAP_BYTES(noOfDataBlocks), sizeof(uchar)); // calloc initializes the custom bitmap with zero bits
+    if(custom_bitmap == NULL){
+    	perror("calloc failed");
+    	exit(1);
+    }
+    uint64 temp, firstDataBlock = 1 + 1 + noOfInodeBlocks + noOfDataBitmapBlocks;
 
 	struct dinode* inode = (struct dinode*)(inodeBlockStartAddr);
-	uint i, j;
+	uint64 i, j;
 
 	// looping through each inode to get the data blocks in use
 	for(i = 0; i < sb->ninodes; i++, inode++){
@@ -293,37 +313,38 @@ void check6(){
 			if(temp == 0) continue;
 
 			// storing information about the block in the custom bitmap
-			custom_bitmap[temp - firstDataBlock] = 1;
+			BIT_SET(custom_bitmap, temp - firstDataBlock);
 		}
 
 		// flagging the bit corresponding to the indirect address block
 		temp = inode->addrs[NDIRECT];
 		if(temp == 0) continue;
-		custom_bitmap[temp - firstDataBlock] = 1;
+		BIT_SET(custom_bitmap, temp - firstDataBlock);
 
 		// looping through each indirect entry to get the blocks in use
-		uint* indirectEntry = (uint* ) (addr + (temp)*BLOCK_SIZE);
+		uint* indirectEntry = (uint* ) BLOCK_ADDR(temp);
 		for(j = 0; j < NINDIRECT; j++, indirectEntry++){
 			temp = *indirectEntry;
 			if(temp == 0) continue;
 
 			// storing information about the block in the custom bitmap
-			custom_bitmap[temp - firstDataBlock] = 1;
+			BIT_SET(custom_bitmap, temp - firstDataBlock);
 		}
 	}
 
 	// comparing our custom bitmap array with the actual bitmap present
 	// looping through all the data blocks
-	for(i = 0; i < sb->nblocks; i++){
-		j = (uint)(i + firstDataBlock);
+	for(i = 0; i < noOfDataBlocks; i++){
+		j = i + firstDataBlock;
 
 		// Checking if the datablock info and the custombitmap info are consistent
-		if(  ((*(dataBitmapStartAddr + j / 8) >> (j % 8))&1)   && custom_bitmap[i] == 0 ){
+		if(  ((*(dataBitmapStartAddr + j / 8) >> (j % 8))&1)   && !BIT_GET(custom_bitmap, i) ){
 			fprintf(stderr, "ERROR: bitmap marks block in use but it is not in use.\n");
 			exit(1);
 		}
 	}
 
+	free(custom_bitmap);
 	return;
 }
 
@@ -333,22 +354,23 @@ void check6(){
 void check7_8(){
 
 	// using directBlocks array to store info about the direct addresses
-	bool directBlocks[sb->nblocks];
-
-	// initializing them with false. false means they haven't been marked as used yet.
-    memset(directBlocks, false, sizeof(bool)* sb->nblocks);
+	// calloc initializes all bits with zero. zero means they haven't been marked as used yet.
+	uchar* directBlocks = calloc(BITMAP_BYTES(noOfDataBlocks), sizeof(uchar));
 
 
 
     // using indirectBlocks array to store info about the direct addresses
-    bool indirectBlocks[sb->nblocks];
+    // calloc initializes all bits with zero. zero means they haven't been marked as used yet.
+    uchar* indirectBlocks = calloc(BITMAP_BYTES(noOfDataBlocks), sizeof(uchar));
 
-    // initializing them with false. false means they haven't been marked as used yet.
-    memset(indirectBlocks, false, sizeof(bool)* sb->nblocks);
+    if(directBlocks == NULL || indirectBlocks == NULL){
+    	perror("calloc failed");
+    	exit(1);
+    }
 
 
     struct dinode* inode = (struct dinode*)(inodeBlockStartAddr);
-    int temp, firstDataBlock = 1 + 1 + noOfInodeBlocks + noOfDataBitmapBlocks;
+    uint64 temp, firstDataBlock = 1 + 1 + noOfInodeBlocks + noOfDataBitmapBlocks;
 	uint i, j;
 
 	// Making the custom direct and indirect address usage block
@@ -362,13 +384,13 @@ void check7_8(){
 			if(temp == 0) continue;
 
 			// if the direct block was already flagged as used, printing the error
-			if(directBlocks[temp-firstDataBlock]){
+			if(BIT_GET(directBlocks, temp-firstDataBlock)){
 				fprintf(stderr, "ERROR: direct address used more than once.\n");
 				exit(1);
 			}
 
 			// else, marking the direct block address as used.
-			directBlocks[temp-firstDataBlock] = true;
+			BIT_SET(directBlocks, temp-firstDataBlock);
 		}
 
 		// checking the consistency of the direct address which points to the indirect addresses blocks
@@ -376,34 +398,36 @@ void check7_8(){
 		if(temp == 0) continue;
 
 		// if the direct block was already flagged as used, printing the error
-		if(directBlocks[temp-firstDataBlock]){
+		if(BIT_GET(directBlocks, temp-firstDataBlock)){
 			fprintf(stderr, "ERROR: direct address used more than once.\n");
 			exit(1);
 		}
 
 		// else, marking the direct block address as used.
-		directBlocks[temp-firstDataBlock] = true;
+		BIT_SET(directBlocks, temp-firstDataBlock);
 
 
 
 
 		// looping through each of the indirect address entries
-		uint* indirectEntry = (uint* ) (addr + (temp)*BLOCK_SIZE);
+		uint* indirectEntry = (uint* ) BLOCK_ADDR(temp);
 		for(j = 0; j < NINDIRECT; j++, indirectEntry++){
 			temp = *indirectEntry;
 			if(temp == 0) continue;
 
 			// if the direct block was already flagged as used, printing the error
-			if(indirectBlocks[temp-firstDataBlock]){
+			if(BIT_GET(indirectBlocks, temp-firstDataBlock)){
 				fprintf(stderr, "ERROR: indirect address used more than once.\n");
 				exit(1);
 			}
 
 			// else, marking the direct block address as used.
-			indirectBlocks[temp-firstDataBlock] = true;
+			BIT_SET(indirectBlocks, temp-firstDataBlock);
 		}
 	}
 
+	free(directBlocks);
+	free(indirectBlocks);
 	return;
 }
 
@@ -413,7 +437,8 @@ void helper(struct dinode* inode, int* trackInodes){
 	// checking if inode type is directory or not
 	if(inode->type != T_DIR) return;
 
-	int i, j, temp;
+	int i, j;
+	uint temp;
 	struct dirent* de;
 	struct dinode* passInode;
 
@@ -422,7 +447,7 @@ void helper(struct dinode* inode, int* trackInodes){
 		if(inode->addrs[i] == 0) continue;
 
 		// looping through all the directory entries present for mapping
-		de = (struct dirent*)(addr + (inode->addrs[i]) * BLOCK_SIZE);
+		de = (struct dirent*) BLOCK_ADDR(inode->addrs[i]);
 		for(j = 0; j < DPB; j++, de++){
 
 			// checking if directory entry is valid, and that they are not dot & dotdot
@@ -437,7 +462,7 @@ void helper(struct dinode* inode, int* trackInodes){
 	}
 
 	if(inode->addrs[NDIRECT] == 0) return;
-	uint* indirectEntry = (uint* )(addr + (inode->addrs[NDIRECT]) * BLOCK_SIZE);
+	uint* indirectEntry = (uint* ) BLOCK_ADDR(inode->addrs[NDIRECT]);
 
 	// looping through each indirect address of the inode, to map it further
 	for(i = 0; i < NINDIRECT; i++, indirectEntry++){
@@ -445,7 +470,7 @@ void helper(struct dinode* inode, int* trackInodes){
 		if(temp == 0) continue;
 
 		// looping through all the directory entries present for mapping in the indirect address
-		de = (struct dirent*)(addr + temp * BLOCK_SIZE);
+		de = (struct dirent*) BLOCK_ADDR(temp);
 		for(j = 0; j < DPB; j++, de++){
 
 			// checking if directory entry is valid, and that they are not dot & dotdot
@@ -472,8 +497,11 @@ void check9_10_11_12(){
 
 	// check 9, 10, 11, and 12 need the whole directory mapping information for their consistent check
 	// using trackInodes to map how many times each of them has been used
-	int trackInodes[sb->ninodes];
-    memset(trackInodes, 0, sizeof(int)* sb->ninodes); // initializing the inodes usage count with 0
+	int* trackInodes = calloc(sb->ninodes, sizeof(int)); // calloc initializes the inodes usage count with 0
+	if(trackInodes == NULL){
+		perror("calloc failed");
+		exit(1);
+	}
 
     // get the root inode, to start the whole directory mapping
     struct dinode* rootInode = (struct dinode*) inodeBlockStartAddr;
@@ -513,6 +541,7 @@ void check9_10_11_12(){
     	}
     }
 
+    free(trackInodes);
     return;
 }
 
@@ -541,36 +570,54 @@ int main(int argc, char* argv[]){
 		exit(1);
 	}
 
+	// the fs img must at least hold the unused block and the super block, and fit in our address space
+	if(fStat.st_size < 2 * BLOCK_SIZE || (uint64)fStat.st_size > SIZE_MAX){
+		fprintf(stderr, "ERROR: bad file system image size.\n");
+		exit(1);
+	}
+
 	// copy the fs img to our own ram, and store its starting address in the addr
-	addr = mmap(NULL, fStat.st_size, PROT_READ, MAP_PRIVATE, fsfd, 0);
+	addr = mmap(NULL, (size_t)fStat.st_size, PROT_READ, MAP_PRIVATE, fsfd, 0);
 	if (addr == MAP_FAILED){
 		perror("mmap failed");
 		exit(1);
 	}
 
 	// store the super block info of the fs img into the global variable sb
-	sb = (struct superblock *) (addr + 1 * BLOCK_SIZE);
+	sb = (struct superblock *) BLOCK_ADDR(1);
+
+	// getting the total number of blocks and data blocks present
+	noOfBlocks = sb->size;
+	noOfDataBlocks = sb->nblocks;
+
+	// the declared size of the fs must fit within the fs img, else we would read past the end of it
+	if(noOfBlocks > (uint64)fStat.st_size / BLOCK_SIZE){
+		fprintf(stderr, "ERROR: file system size exceeds image size.\n");
+		exit(1);
+	}
 
 	// calculating the number of inode blocks present in the fs img
 	noOfInodeBlocks = sb->ninodes / IPB + 1;
 
 	// calculating the number of data bitmap blocks present in the fs img
-	noOfDataBitmapBlocks = sb->size / (BLOCK_SIZE * 8) + 1;
+	noOfDataBitmapBlocks = noOfBlocks / (BLOCK_SIZE * 8) + 1;
 
-	// getting the total number of data blocks present
-	noOfDataBlocks =  sb->nblocks;
+	// confirming the number of blocks calculated individually equals the total block present in the fs img
+	// each term is checked against the total first, so that the sum cannot wrap around
+	if(noOfDataBlocks > noOfBlocks || 2 + noOfInodeBlocks + noOfDataBitmapBlocks > noOfBlocks ||
+			2 + noOfInodeBlocks + noOfDataBitmapBlocks + noOfDataBlocks != noOfBlocks){
+		fprintf(stderr, "ERROR: bad file system layout in super block.\n");
+		exit(1);
+	}
 
 	// calculating the address of the first inode block
-	inodeBlockStartAddr = addr + (BLOCK_SIZE * 2);
+	inodeBlockStartAddr = BLOCK_ADDR(2);
 
 	// calculating the address of the first data bitmap block
-	dataBitmapStartAddr = addr + (BLOCK_SIZE * (2 + noOfInodeBlocks));
+	dataBitmapStartAddr = BLOCK_ADDR(2 + noOfInodeBlocks);
 
 	// calculating the address of the first data block
-	dataBlockStartAddr  = addr + (BLOCK_SIZE * (2 + noOfInodeBlocks + noOfDataBitmapBlocks));
-
-	// confirming the number of blocks calculated individually equals the total block present in the fs imgs
-	assert(2 + noOfInodeBlocks + noOfDataBitmapBlocks + noOfDataBlocks == sb->size);
+	dataBlockStartAddr  = BLOCK_ADDR(2 + noOfInodeBlocks + noOfDataBitmapBlocks);
 
 	// performing checks as per the project 4 description
 	check1();